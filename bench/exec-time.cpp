@@ -0,0 +1,44 @@
+// Times exec-to-exit of one or more programs.
+// Usage: exec-time <runs> <program> [<program>...]
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+extern char** environ;
+
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    std::fprintf(stderr, "usage: %s <runs> <program>...\n", argv[0]);
+    return 2;
+  }
+  long runs = std::strtol(argv[1], nullptr, 10);
+  if (runs <= 0) {
+    std::fprintf(stderr, "%s: invalid run count\n", argv[0]);
+    return 2;
+  }
+
+  for (int p = 2; p < argc; p++) {
+    char* child_argv[] = {argv[p], const_cast<char*>("-v"),
+      const_cast<char*>("--output"), const_cast<char*>("out"),
+      const_cast<char*>("file"), nullptr};
+
+    auto start = std::chrono::steady_clock::now();
+    for (long r = 0; r < runs; r++) {
+      pid_t pid;
+      if (posix_spawn(&pid, argv[p], nullptr, nullptr, child_argv, environ)) {
+        std::fprintf(stderr, "%s: cannot run %s\n", argv[0], argv[p]);
+        return 1;
+      }
+      int status;
+      waitpid(pid, &status, 0);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double total_us =
+      std::chrono::duration<double, std::micro>(end - start).count();
+    std::printf("%s: %.1f us/run (%ld runs)\n", argv[p], total_us / runs, runs);
+  }
+}
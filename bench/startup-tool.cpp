@@ -0,0 +1,27 @@
+// A minimal coreutils-style tool. It is built once with MTAP_NO_IOSTREAM and
+// once without, so that exec-to-exit times can be compared.
+#include <cstdlib>
+#include <string_view>
+#include <mtap/mtap.hpp>
+
+using mtap::option, mtap::pos_arg;
+
+int main(int argc, const char* argv[]) {
+  bool verbose = false;
+  std::string_view output;
+  size_t nfiles = 0;
+
+  mtap::parser {
+    option<"-v", 0>([&]() {
+      verbose = true;
+    }),
+    option<"--output", 1>([&](std::string_view val) {
+      output = val;
+    }),
+    pos_arg([&](std::string_view) {
+      ++nfiles;
+    }),
+  }.parse(argc, argv);
+
+  return (verbose && output.empty() && nfiles == 0) ? 1 : 0;
+}
@@ -0,0 +1,392 @@
+// Differential testing of mtap against getopt_long.
+//
+// Both parsers are run on the same argv and their event streams are
+// compared. argv is decoded from a byte string, so the same decoder serves
+// the random harness and the libFuzzer entry point. The decoder only builds
+// command lines on which mtap and GNU getopt_long are meant to agree:
+// - no "--name=value" (mtap has no such syntax)
+// - no abbreviated long options (mtap requires exact names)
+// - no "-" followed by a non-alphanumeric character (mtap treats it as a
+//   positional argument)
+// Both parsers stop at the first error.
+//
+// getopt_long has no multi-arg or last_wins options, so the reference
+// models them: an N-arg option takes optarg plus the next N - 1 arguments,
+// and only the last occurrence of a last_wins option is kept, moved to the
+// end in declaration order (dropped entirely on error).
+#ifndef _MTAP_FUZZ_DIFFERENTIAL_HPP_
+#define _MTAP_FUZZ_DIFFERENTIAL_HPP_
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <mtap/mtap.hpp>
+
+namespace mtap_fuzz {
+  // An option callback firing, or an error (id == error_id).
+  struct event {
+    static constexpr int error_id = -1;
+
+    int id;
+    std::string value;
+
+    bool operator==(const event&) const = default;
+  };
+  using event_list = std::vector<event>;
+
+  struct opt_desc {
+    std::string sw;
+    size_t nargs;
+    bool last_wins;
+  };
+
+  // Thrown from the error sink so that mtap returns instead of exiting.
+  struct parse_stopped {};
+
+  template <size_t I>
+  struct recorder {
+    event_list* out;
+
+    template <class... Vs>
+    void operator()(Vs... vals) const {
+      if constexpr (sizeof...(Vs) == 0)
+        out->push_back({int(I), {}});
+      else
+        (out->push_back({int(I), std::string(vals)}), ...);
+    }
+  };
+
+  template <
+    mtap::fixed_string Switch, size_t NArgs,
+    mtap::repeat_policy Policy = mtap::every_time>
+  struct spec {};
+
+  template <class... Specs>
+  struct table;
+
+  template <
+    mtap::fixed_string... Sws, size_t... Ns, mtap::repeat_policy... Ps>
+  struct table<spec<Sws, Ns, Ps>...> {
+    static const std::vector<opt_desc>& options() {
+      static const std::vector<opt_desc> opts {
+        {std::string(std::string_view(Sws)), Ns, Ps == mtap::last_wins}...};
+      return opts;
+    }
+
+    static void run_mtap(int argc, const char* argv[], event_list& out) {
+      [&]<size_t... Is>(std::index_sequence<Is...>) {
+        mtap::parser p {mtap::option<Sws, Ns, Ps>(recorder<Is> {&out})...};
+        try {
+          p.parse(argc, argv, [](std::string_view, std::string_view) {
+            throw parse_stopped {};
+          });
+        }
+        catch (const parse_stopped&) {
+          out.push_back({event::error_id, {}});
+        }
+      }
+      (std::index_sequence_for<spec<Sws, Ns, Ps>...> {});
+    }
+  };
+
+  // getopt_long reference, configured from an option table.
+  class getopt_reference {
+  public:
+    getopt_reference(const std::vector<opt_desc>& opts) : opts(opts) {
+      std::fill(std::begin(short_ids), std::end(short_ids), -1);
+      // '-' returns non-options in order, as mtap does
+      optstring = "-";
+      for (size_t i = 0; i < opts.size(); i++) {
+        const auto& o = opts[i];
+        if (o.sw == "\1") {
+          posarg = int(i);
+        }
+        else if (o.sw.size() == 2) {
+          optstring += o.sw[1];
+          if (o.nargs)
+            optstring += ':';
+          short_ids[(unsigned char) o.sw[1]] = int(i);
+        }
+        else {
+          longopts.push_back(
+            {o.sw.c_str() + 2, o.nargs ? required_argument : no_argument,
+             nullptr, 256 + int(i)});
+        }
+      }
+      longopts.push_back({nullptr, 0, nullptr, 0});
+    }
+
+    void run(int argc, const char* argv[], event_list& out) const {
+      run_getopt(argc, argv, out);
+      apply_last_wins(out);
+    }
+
+  private:
+    void run_getopt(int argc, const char* argv[], event_list& out) const {
+      // getopt_long may permute argv, so give it a copy
+      std::vector<char*> args;
+      for (int i = 0; i < argc; i++)
+        args.push_back(const_cast<char*>(argv[i]));
+      args.push_back(nullptr);
+      optind = 0;
+      opterr = 0;
+
+      int c;
+      while ((c = getopt_long(
+                argc, args.data(), optstring.c_str(), longopts.data(),
+                nullptr)) != -1) {
+        if (c == 1) {
+          if (posarg >= 0)
+            out.push_back({posarg, optarg});
+        }
+        else {
+          int id = -1;
+          if (c >= 256)
+            id = c - 256;
+          else if (c != '?' && c != ':')
+            id = short_ids[c];
+          if (id < 0 || !take_values(id, c < 256, argc, argv, out)) {
+            out.push_back({event::error_id, {}});
+            return;
+          }
+        }
+      }
+      // everything after "--"
+      if (posarg >= 0) {
+        for (int i = optind; i < argc; i++)
+          out.push_back({posarg, argv[i]});
+      }
+    }
+
+    // Records the values of option id after getopt_long returned it. Extra
+    // values of a multi-arg option are taken from the following arguments.
+    // Returns false where mtap reports an error.
+    bool take_values(
+      int id, bool is_short, int argc, const char* argv[],
+      event_list& out) const {
+      size_t nargs = opts[id].nargs;
+      if (nargs == 0) {
+        out.push_back({id, {}});
+        return true;
+      }
+      // a multi-arg short option's first value must be a separate argument
+      if (nargs > 1 && is_short && optarg != argv[optind - 1])
+        return false;
+      // mtap checks the argument count before running the callback
+      if (size_t(argc - optind) < nargs - 1)
+        return false;
+      out.push_back({id, optarg});
+      for (size_t i = 1; i < nargs; i++)
+        out.push_back({id, argv[optind++]});
+      return true;
+    }
+
+    // Keeps only the last occurrence of each last_wins option, after all
+    // other events and in declaration order. mtap never runs them if parsing
+    // fails.
+    void apply_last_wins(event_list& out) const {
+      bool failed = !out.empty() && out.back().id == event::error_id;
+      event_list res;
+      std::vector<event_list> groups(opts.size());
+      for (size_t i = 0; i < out.size();) {
+        int id = out[i].id;
+        if (id == event::error_id || !opts[id].last_wins) {
+          res.push_back(out[i++]);
+          continue;
+        }
+        // a 0-arg option still has one event
+        size_t size = std::max<size_t>(opts[id].nargs, 1);
+        groups[id].assign(out.begin() + i, out.begin() + i + size);
+        i += size;
+      }
+      if (!failed) {
+        for (const auto& g : groups)
+          res.insert(res.end(), g.begin(), g.end());
+      }
+      out = std::move(res);
+    }
+
+    std::vector<opt_desc> opts;
+    std::string optstring;
+    std::vector<option> longopts;
+    int short_ids[256];
+    int posarg = -1;
+  };
+
+  // Reads bytes, yielding 0 once the input is exhausted.
+  struct byte_reader {
+    const uint8_t* data;
+    size_t size;
+
+    bool empty() const { return size == 0; }
+    uint8_t next() {
+      if (size == 0)
+        return 0;
+      --size;
+      return *data++;
+    }
+  };
+
+  // Decodes bytes into an argv (including argv[0]) built from the table's
+  // switches, values and a few unknown or special tokens.
+  inline std::vector<std::string> decode_argv(
+    const std::vector<opt_desc>& opts, byte_reader& in) {
+    static constexpr const char* values[] = {
+      "foo", "bar", "", "-", "--", "--zz", "-Z", "x-y"};
+
+    std::string shorts = "Z";
+    std::vector<std::string> longs;
+    for (const auto& o : opts) {
+      if (o.sw.size() == 2)
+        shorts += o.sw[1];
+      else if (o.sw != "\1")
+        longs.push_back(o.sw);
+    }
+
+    std::vector<std::string> res {"prog"};
+    size_t count = in.next() % 12;
+    for (size_t n = 0; n < count && !in.empty(); n++) {
+      uint8_t sel = in.next();
+      switch (sel % 5) {
+        case 0:
+          res.push_back(values[in.next() % std::size(values)]);
+          break;
+        case 1:
+          if (!longs.empty()) {
+            res.push_back(longs[in.next() % longs.size()]);
+            break;
+          }
+          [[fallthrough]];
+        case 2:
+          res.push_back({'-', shorts[in.next() % shorts.size()]});
+          break;
+        case 3: {
+          // bundled short options
+          std::string arg = "-";
+          size_t len      = 2 + in.next() % 3;
+          for (size_t i = 0; i < len; i++)
+            arg += shorts[in.next() % shorts.size()];
+          res.push_back(arg);
+          break;
+        }
+        case 4:
+          // short option with an attached value
+          res.push_back(
+            std::string {'-', shorts[in.next() % shorts.size()]} +
+            values[in.next() % 2]);
+          break;
+      }
+    }
+    return res;
+  }
+
+  inline std::string format_argv(const std::vector<std::string>& args) {
+    std::string res;
+    for (const auto& a : args) {
+      if (!res.empty())
+        res += ' ';
+      res += '\'' + a + '\'';
+    }
+    return res;
+  }
+
+  inline std::string format_events(
+    const std::vector<opt_desc>& opts, const event_list& evs) {
+    std::string res;
+    for (const auto& e : evs) {
+      if (!res.empty())
+        res += ", ";
+      if (e.id == event::error_id)
+        res += "<error>";
+      else {
+        res += (opts[e.id].sw == "\1") ? "<pos>" : opts[e.id].sw;
+        if (opts[e.id].nargs)
+          res += "=" + e.value;
+      }
+    }
+    return "[" + res + "]";
+  }
+
+  struct run_result {
+    bool match;
+    std::chrono::nanoseconds mtap_time;
+    std::chrono::nanoseconds getopt_time;
+  };
+
+  // Runs both parsers on one input. Prints the input and both event streams
+  // to stderr on a mismatch.
+  template <class Table>
+  run_result run_one(const std::vector<std::string>& args) {
+    static const getopt_reference ref(Table::options());
+
+    std::vector<const char*> argv;
+    for (const auto& a : args)
+      argv.push_back(a.c_str());
+    int argc = int(argv.size());
+    argv.push_back(nullptr);
+
+    event_list mtap_events, getopt_events;
+    using clock = std::chrono::steady_clock;
+
+    auto t0 = clock::now();
+    Table::run_mtap(argc, argv.data(), mtap_events);
+    auto t1 = clock::now();
+    ref.run(argc, argv.data(), getopt_events);
+    auto t2 = clock::now();
+
+    bool match = mtap_events == getopt_events;
+    if (!match) {
+      const auto& opts = Table::options();
+      std::fprintf(
+        stderr, "mismatch: %s\n  mtap:   %s\n  getopt: %s\n",
+        format_argv(args).c_str(), format_events(opts, mtap_events).c_str(),
+        format_events(opts, getopt_events).c_str());
+    }
+    return {match, t1 - t0, t2 - t1};
+  }
+
+  using table_mixed = table<
+    spec<"-a", 0>, spec<"-b", 0>, spec<"-c", 1>, spec<"--verbose", 0>,
+    spec<"--output", 1>, spec<"\1", 1>>;
+  using table_shorts = table<
+    spec<"-x", 1>, spec<"-y", 0>, spec<"-0", 0>, spec<"-z", 1>>;
+  using table_longs = table<
+    spec<"--log-level", 1>, spec<"--dry-run", 0>, spec<"--jobs", 1>,
+    spec<"\1", 1>>;
+  using table_multi = table<
+    spec<"-p", 2>, spec<"-a", 0>, spec<"-c", 1>, spec<"--pair", 2>,
+    spec<"--triple", 3>, spec<"\1", 1>>;
+  using table_last = table<
+    spec<"-l", 1, mtap::last_wins>, spec<"-q", 0, mtap::last_wins>,
+    spec<"-a", 0>, spec<"--level", 1, mtap::last_wins>,
+    spec<"--range", 2, mtap::last_wins>, spec<"-r", 2, mtap::last_wins>,
+    spec<"\1", 1>>;
+
+  // Runs one input, using the first byte to select the option table.
+  inline run_result run_bytes(const uint8_t* data, size_t size) {
+    byte_reader in {data, size};
+    switch (in.next() % 5) {
+      case 0:
+        return run_one<table_mixed>(decode_argv(table_mixed::options(), in));
+      case 1:
+        return run_one<table_shorts>(
+          decode_argv(table_shorts::options(), in));
+      case 2:
+        return run_one<table_longs>(decode_argv(table_longs::options(), in));
+      case 3:
+        return run_one<table_multi>(decode_argv(table_multi::options(), in));
+      default:
+        return run_one<table_last>(decode_argv(table_last::options(), in));
+    }
+  }
+}  // namespace mtap_fuzz
+#endif
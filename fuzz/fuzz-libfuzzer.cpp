@@ -0,0 +1,13 @@
+// libFuzzer entry point for the differential harness. Aborts on the first
+// input where mtap and getopt_long disagree.
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include "differential.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  if (!mtap_fuzz::run_bytes(data, size).match)
+    std::abort();
+  return 0;
+}
@@ -0,0 +1,90 @@
+// Standalone randomized differential harness. Generates random inputs, runs
+// mtap and getopt_long on each, and reports mismatches and parse times.
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mtap/mtap.hpp>
+
+#include "differential.hpp"
+
+using mtap::option;
+
+// Parses an unsigned number, reporting bad values as argument errors.
+unsigned long parse_number(std::string_view val) {
+  std::string str(val);
+  size_t end = 0;
+  unsigned long res;
+  try {
+    if (str.empty() || str[0] == '-')
+      throw std::invalid_argument("negative");
+    res = std::stoul(str, &end);
+  }
+  catch (const std::logic_error&) {
+    throw mtap::argument_error("Invalid number: " + str);
+  }
+  if (end != str.size())
+    throw mtap::argument_error("Invalid number: " + str);
+  return res;
+}
+
+int main(int argc, const char* argv[]) {
+  unsigned long iterations = 100000;
+  unsigned long seed       = std::random_device {}();
+  bool verbose             = false;
+
+  mtap::parser {
+    option<"--help", 0, "Display this help and exit">(mtap::print_help),
+    option<"--iterations", 1, "Number of random inputs to run", "N">(
+      [&](std::string_view val) {
+        iterations = parse_number(val);
+      }),
+    option<"--seed", 1, "Seed for the input generator", "SEED">(
+      [&](std::string_view val) {
+        seed = parse_number(val);
+      }),
+    option<"-v", 0, "Print the parse times of every input">([&]() {
+      verbose = true;
+    }),
+  }.parse(argc, argv);
+
+  std::mt19937_64 rng(seed);
+  std::uniform_int_distribution<int> byte_dist(0, 255);
+  std::uniform_int_distribution<size_t> size_dist(1, 48);
+
+  unsigned long mismatches = 0;
+  std::chrono::nanoseconds mtap_total {0}, getopt_total {0}, mtap_max {0};
+  std::vector<uint8_t> input;
+  for (unsigned long n = 0; n < iterations; n++) {
+    input.resize(size_dist(rng));
+    for (auto& b : input)
+      b = uint8_t(byte_dist(rng));
+
+    auto res = mtap_fuzz::run_bytes(input.data(), input.size());
+    if (!res.match)
+      ++mismatches;
+    mtap_total += res.mtap_time;
+    getopt_total += res.getopt_time;
+    mtap_max = std::max(mtap_max, res.mtap_time);
+    if (verbose) {
+      std::printf(
+        "input %lu: mtap %lld ns, getopt %lld ns\n", n,
+        (long long) res.mtap_time.count(), (long long) res.getopt_time.count());
+    }
+  }
+
+  std::printf(
+    "seed %lu: %lu inputs, %lu mismatches\n"
+    "mtap:   %.1f ns/input (max %lld ns)\n"
+    "getopt: %.1f ns/input\n",
+    seed, iterations, mismatches,
+    iterations ? double(mtap_total.count()) / iterations : 0.0,
+    (long long) mtap_max.count(),
+    iterations ? double(getopt_total.count()) / iterations : 0.0);
+  return mismatches ? 1 : 0;
+}
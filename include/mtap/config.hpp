@@ -0,0 +1,134 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef _MTAP_CONFIG_HPP_
+#define _MTAP_CONFIG_HPP_
+
+// Config files are memory-mapped on POSIX systems. Elsewhere, they are read
+// into a buffer with <cstdio>.
+#if __has_include(<unistd.h>) && __has_include(<sys/mman.h>)
+  #define _MTAP_CONFIG_MMAP_
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <mtap/mtap.hpp>
+
+namespace mtap {
+  namespace details {
+    // A read-only memory mapping of a whole regular file. Other files, such
+    // as pipes, and all files without POSIX, are read into a buffer instead.
+    class mapped_file : public config_source {
+    public:
+#ifdef _MTAP_CONFIG_MMAP_
+      mapped_file(const char* path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+          throw argument_error("Cannot open file");
+        struct stat st;
+        if (::fstat(fd, &st) < 0) {
+          ::close(fd);
+          throw argument_error("Cannot open file");
+        }
+        if (!S_ISREG(st.st_mode)) {
+          // st_size is meaningless here, so read until end of file
+          char chunk[4096];
+          ssize_t n;
+          while ((n = ::read(fd, chunk, sizeof(chunk))) != 0) {
+            if (n < 0) {
+              ::close(fd);
+              throw argument_error("Cannot read file");
+            }
+            m_buffer.append(chunk, n);
+          }
+        }
+        else if (st.st_size > 0) {
+          void* ptr =
+            ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+          if (ptr == MAP_FAILED) {
+            ::close(fd);
+            throw argument_error("Cannot map file");
+          }
+          m_mapping = static_cast<const char*>(ptr);
+          m_size    = st.st_size;
+        }
+        ::close(fd);
+      }
+#else
+      mapped_file(const char* path) {
+        std::FILE* file = std::fopen(path, "rb");
+        if (!file)
+          throw argument_error("Cannot open file");
+        char chunk[4096];
+        size_t n;
+        while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+          m_buffer.append(chunk, n);
+        bool failed = std::ferror(file);
+        std::fclose(file);
+        if (failed)
+          throw argument_error("Cannot read file");
+      }
+#endif
+
+      mapped_file(const mapped_file&) = delete;
+      mapped_file& operator=(const mapped_file&) = delete;
+
+      ~mapped_file() {
+#ifdef _MTAP_CONFIG_MMAP_
+        if (m_mapping)
+          ::munmap(const_cast<char*>(m_mapping), m_size);
+#endif
+      }
+
+      std::string_view view() const override {
+        if (m_mapping)
+          return {m_mapping, m_size};
+        return m_buffer;
+      }
+
+    private:
+      const char* m_mapping = nullptr;
+      size_t m_size         = 0;
+      std::string m_buffer;
+    };
+  }  // namespace details
+
+  // Applies options from a "key = value" config file, reporting errors to a
+  // custom sink. The sink receives "path:line:col" and the error message.
+  // Call this before parser::parse() so that argv overrides the file.
+  // On error, the program exits with EXIT_FAILURE.
+  template <
+    class... Opts,
+    details::callable<void(std::string_view, std::string_view)> E>
+  void parse_config(parser<Opts...>& p, const char* path, E&& on_error) {
+    std::unique_ptr<details::config_source> src;
+    try {
+      src = std::make_unique<details::mapped_file>(path);
+    }
+    catch (const argument_error& err) {
+      on_error(path, err.what());
+      exit(EXIT_FAILURE);
+    }
+    p.apply_config(std::move(src), path, on_error);
+  }
+
+  // Applies options from a "key = value" config file, reporting errors to
+  // standard error.
+  template <class... Opts>
+  void parse_config(parser<Opts...>& p, const char* path) {
+    parse_config(p, path, details::report_error);
+  }
+}  // namespace mtap
+#endif
@@ -91,6 +91,14 @@ namespace mtap {
       a.begin(), a.end(), b.begin(), b.end());
   }
 
+  template <size_t Sa, size_t Sb>
+  constexpr fixed_string<Sa + Sb> operator+(
+    const fixed_string<Sa>& a, const fixed_string<Sb>& b) {
+    fixed_string<Sa + Sb> res {};
+    std::copy(b.begin(), b.end(), std::copy(a.begin(), a.end(), res.begin()));
+    return res;
+  }
+
   template <size_t S>
   fixed_string(const char (&str)[S]) -> fixed_string<S - 1>;
 }  // namespace mtap
@@ -7,11 +7,10 @@
 #ifndef _MTAP_OPTION_HPP_
 #define _MTAP_OPTION_HPP_
 #include <algorithm>
+#include <array>
+#include <cstdio>
 #include <cstdlib>
-#include <exception>
-#include <functional>
 #include <initializer_list>
-#include <iostream>
 #include <memory>
 #include <optional>
 #include <stdexcept>
@@ -19,10 +18,23 @@
 #include <string_view>
 #include <tuple>
 #include <type_traits>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
+// Define MTAP_NO_IOSTREAM to report parse errors with write(2) instead of
+// std::cerr, and print help text with writev(2). This keeps <iostream> and
+// its static initializers out of the program. Without POSIX, both fall back
+// to <cstdio>.
+#ifdef MTAP_NO_IOSTREAM
+  #if __has_include(<unistd.h>) && __has_include(<sys/uio.h>)
+    #define _MTAP_POSIX_
+    #include <sys/uio.h>
+    #include <unistd.h>
+  #endif
+#else
+  #include <iostream>
+#endif
+
 #include <mtap/fixed_string.hpp>
 #include <mtap/meta_helpers.hpp>
 
@@ -37,6 +49,12 @@ namespace mtap {
 
   enum class opt_type : uint16_t { short_opt, long_opt, pos_arg };
 
+  // Controls what happens when an option appears more than once.
+  // every_time: the callback runs for each occurrence, in order.
+  // last_wins: the callback runs once, after parsing, for the last occurrence.
+  enum class repeat_policy : uint16_t { every_time, last_wins };
+  using enum repeat_policy;
+
   namespace details {
     template <class T, size_t I>
     using index_type_sink = T;
@@ -66,11 +84,73 @@ namespace mtap {
     concept callable =
       callable_helper(std::type_identity<T> {}, std::type_identity<F> {});
 
+    // Writes "prog: what" to standard error.
+    inline void report_error(std::string_view prog, std::string_view what) {
+#ifdef MTAP_NO_IOSTREAM
+      auto put = [](std::string_view str) {
+  #ifdef _MTAP_POSIX_
+        while (!str.empty()) {
+          ssize_t n = ::write(2, str.data(), str.size());
+          if (n <= 0)
+            return;
+          str.remove_prefix(n);
+        }
+  #else
+        std::fwrite(str.data(), 1, str.size(), stderr);
+  #endif
+      };
+      put(prog);
+      put(": ");
+      put(what);
+      put("\n");
+#else
+      std::cerr << prog << ": " << what << '\n';
+#endif
+    }
+
     constexpr bool isalnum(char c) {
       return ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z') ||
         ('0' <= c && c <= '9');
     }
 
+    constexpr bool isblank(char c) {
+      return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    constexpr std::string_view trim(std::string_view str) {
+      while (!str.empty() && isblank(str.front()))
+        str.remove_prefix(1);
+      while (!str.empty() && isblank(str.back()))
+        str.remove_suffix(1);
+      return str;
+    }
+
+    // Splits str into blank-separated fields. Stores at most n fields in out
+    // and returns the total number of fields.
+    constexpr size_t split_fields(
+      std::string_view str, std::string_view* out, size_t n) {
+      size_t count = 0;
+      str          = trim(str);
+      while (!str.empty()) {
+        size_t end = 0;
+        while (end < str.size() && !isblank(str[end]))
+          ++end;
+        if (count < n)
+          out[count] = str.substr(0, end);
+        ++count;
+        str = trim(str.substr(end));
+      }
+      return count;
+    }
+
+    // Owns the text of a config file. See mtap/config.hpp.
+    class config_source {
+    public:
+      virtual ~config_source() = default;
+
+      virtual std::string_view view() const = 0;
+    };
+
     // Simultaneously classifies and validates an option.
     static constexpr std::optional<opt_type> classify_opt(
       std::string_view str, size_t nargs) {
@@ -107,14 +187,19 @@ namespace mtap {
     }
 
     template <
-      fixed_string Switch, size_t NArgs, callable<make_callback_sig<NArgs>> F>
+      fixed_string Switch, size_t NArgs, callable<make_callback_sig<NArgs>> F,
+      repeat_policy Policy = every_time, fixed_string Desc = "",
+      fixed_string Meta = "">
     struct opt_impl {
       static_assert(
         classify_opt(Switch, NArgs).has_value(), "Invalid option switch");
 
-      static constexpr auto name  = Switch;
-      static constexpr auto type  = classify_opt(Switch, NArgs).value();
-      static constexpr auto nargs = NArgs;
+      static constexpr auto name   = Switch;
+      static constexpr auto type   = classify_opt(Switch, NArgs).value();
+      static constexpr auto nargs  = NArgs;
+      static constexpr auto policy = Policy;
+      static constexpr auto desc   = Desc;
+      static constexpr auto meta   = Meta;
 
       using function_t = F;
       using callback_t = make_callback_sig<NArgs>;
@@ -127,28 +212,63 @@ namespace mtap {
     struct is_some_opt : std::false_type {};
     template <
       fixed_string N, size_t S,
-      details::callable<details::make_callback_sig<S>> F>
-    struct is_some_opt<opt_impl<N, S, F>> : std::true_type {};
+      details::callable<details::make_callback_sig<S>> F, repeat_policy P,
+      fixed_string D, fixed_string M>
+    struct is_some_opt<opt_impl<N, S, F, P, D, M>> : std::true_type {};
 
     template <class T>
     concept some_option = is_some_opt<T>::value;
   }  // namespace details
   template <
-    fixed_string Switch, size_t NArgs,
+    fixed_string Switch, size_t NArgs, repeat_policy Policy = every_time,
+    details::callable<details::make_callback_sig<NArgs>> F>
+  auto option(F&& fn) {
+    return details::opt_impl<Switch, NArgs, F, Policy>(std::forward<F>(fn));
+  }
+
+  // Same as above, but with a description and metavar for the help text.
+  // If Meta is empty, each argument is shown as ARG.
+  template <
+    fixed_string Switch, size_t NArgs, fixed_string Desc,
+    fixed_string Meta = "",
+    details::callable<details::make_callback_sig<NArgs>> F>
+  auto option(F&& fn) {
+    return details::opt_impl<Switch, NArgs, F, every_time, Desc, Meta>(
+      std::forward<F>(fn));
+  }
+
+  // Same as above, with a repeat policy. As in the first overload, the
+  // policy comes third.
+  template <
+    fixed_string Switch, size_t NArgs, repeat_policy Policy,
+    fixed_string Desc, fixed_string Meta = "",
     details::callable<details::make_callback_sig<NArgs>> F>
   auto option(F&& fn) {
-    return details::opt_impl<Switch, NArgs, F>(std::forward<F>(fn));
+    return details::opt_impl<Switch, NArgs, F, Policy, Desc, Meta>(
+      std::forward<F>(fn));
   }
 
-  template <details::callable<details::make_callback_sig<1>> F>
+  // Pass as the callback of a 0-arg option to print the generated help text
+  // and exit.
+  struct print_help_t {
+    void operator()() const {}
+  };
+  inline constexpr print_help_t print_help {};
+
+  template <
+    repeat_policy Policy = every_time,
+    details::callable<details::make_callback_sig<1>> F>
   auto pos_arg(F&& fn) {
-    return details::opt_impl<"\1", 1, F>(std::forward<F>(fn));
+    return details::opt_impl<"\1", 1, F, Policy>(std::forward<F>(fn));
   }
 
   namespace details {
 
-    template <fixed_string... Ss, size_t... Ns, class... Fs>
-    constexpr size_t count_shorts(type_sequence<opt_impl<Ss, Ns, Fs>...>) {
+    template <
+      fixed_string... Ss, size_t... Ns, class... Fs, repeat_policy... Ps,
+      fixed_string... Ds, fixed_string... Ms>
+    constexpr size_t count_shorts(
+      type_sequence<opt_impl<Ss, Ns, Fs, Ps, Ds, Ms>...>) {
       std::initializer_list<std::pair<std::string_view, size_t>> pairs = {
         {std::string_view(Ss), Ns}...};
 
@@ -158,8 +278,11 @@ namespace mtap {
           return classify_opt(pair.first, pair.second) == opt_type::short_opt;
         });
     }
-    template <fixed_string... Ss, size_t... Ns, class... Fs>
-    constexpr size_t count_longs(type_sequence<opt_impl<Ss, Ns, Fs>...>) {
+    template <
+      fixed_string... Ss, size_t... Ns, class... Fs, repeat_policy... Ps,
+      fixed_string... Ds, fixed_string... Ms>
+    constexpr size_t count_longs(
+      type_sequence<opt_impl<Ss, Ns, Fs, Ps, Ds, Ms>...>) {
       std::initializer_list<std::pair<std::string_view, size_t>> pairs = {
         {std::string_view(Ss), Ns}...};
 
@@ -170,9 +293,11 @@ namespace mtap {
         });
     }
 
-    template <fixed_string... Ss, size_t... Ns, class... Fs>
+    template <
+      fixed_string... Ss, size_t... Ns, class... Fs, repeat_policy... Ps,
+      fixed_string... Ds, fixed_string... Ms>
     constexpr decltype(auto) filter_shorts(
-      type_sequence<opt_impl<Ss, Ns, Fs>...> seq) {
+      type_sequence<opt_impl<Ss, Ns, Fs, Ps, Ds, Ms>...> seq) {
       std::initializer_list<std::pair<std::string_view, size_t>> pairs = {
         {std::string_view(Ss), Ns}...};
       std::array<std::pair<char, size_t>, count_shorts(seq)> arr;
@@ -187,9 +312,11 @@ namespace mtap {
 
       return arr;
     }
-    template <fixed_string... Ss, size_t... Ns, class... Fs>
+    template <
+      fixed_string... Ss, size_t... Ns, class... Fs, repeat_policy... Ps,
+      fixed_string... Ds, fixed_string... Ms>
     constexpr decltype(auto) filter_longs(
-      type_sequence<opt_impl<Ss, Ns, Fs>...> seq) {
+      type_sequence<opt_impl<Ss, Ns, Fs, Ps, Ds, Ms>...> seq) {
       std::initializer_list<std::pair<std::string_view, size_t>> pairs = {
         {std::string_view(Ss), Ns}...};
       std::array<std::pair<std::string_view, size_t>, count_longs(seq)> arr;
@@ -205,9 +332,11 @@ namespace mtap {
       return arr;
     }
 
-    template <fixed_string... Ss, size_t... Ns, class... Fs>
+    template <
+      fixed_string... Ss, size_t... Ns, class... Fs, repeat_policy... Ps,
+      fixed_string... Ds, fixed_string... Ms>
     constexpr decltype(auto) find_posarg(
-      type_sequence<opt_impl<Ss, Ns, Fs>...> seq) {
+      type_sequence<opt_impl<Ss, Ns, Fs, Ps, Ds, Ms>...> seq) {
       std::initializer_list<std::pair<std::string_view, size_t>> pairs = {
         {std::string_view(Ss), Ns}...};
 
@@ -226,26 +355,301 @@ namespace mtap {
       }
       return res;
     }
+
+    struct help_entry {
+      std::string_view sw;
+      size_t nargs;
+      std::string_view desc;
+      std::string_view meta;
+    };
+
+    inline constexpr size_t help_width   = 80;
+    inline constexpr size_t help_max_col = 30;
+
+    // Appends to a buffer, or only counts characters if the buffer is null.
+    struct help_writer {
+      char* out;
+      size_t size = 0;
+
+      constexpr void put(char c) {
+        if (out)
+          out[size] = c;
+        ++size;
+      }
+      constexpr void put(std::string_view str) {
+        for (char c : str)
+          put(c);
+      }
+      constexpr void pad(size_t n) {
+        for (size_t i = 0; i < n; i++)
+          put(' ');
+      }
+    };
+
+    // Length of "  -x META" for an entry.
+    constexpr size_t help_left_size(const help_entry& e) {
+      if (e.nargs == 0)
+        return 2 + e.sw.size();
+      else if (!e.meta.empty())
+        return 2 + e.sw.size() + 1 + e.meta.size();
+      else
+        return 2 + e.sw.size() + 4 * e.nargs;
+    }
+
+    // Formats the option list, one option per line, with descriptions
+    // aligned and wrapped to help_width. Returns the number of characters.
+    template <size_t N>
+    constexpr size_t format_help(
+      const std::array<help_entry, N>& entries, char* out) {
+      help_writer w {out};
+
+      size_t col = 0;
+      for (const auto& e : entries)
+        col = std::max(col, help_left_size(e) + 2);
+      col = std::min(col, help_max_col);
+
+      for (const auto& e : entries) {
+        w.put("  ");
+        w.put(e.sw);
+        if (e.nargs > 0) {
+          if (!e.meta.empty()) {
+            w.put(' ');
+            w.put(e.meta);
+          }
+          else {
+            for (size_t i = 0; i < e.nargs; i++)
+              w.put(" ARG");
+          }
+        }
+        if (e.desc.empty()) {
+          w.put('\n');
+          continue;
+        }
+        size_t left = help_left_size(e);
+        if (left + 2 <= col) {
+          w.pad(col - left);
+        }
+        else {
+          w.put('\n');
+          w.pad(col);
+        }
+
+        // greedy word wrap
+        size_t avail    = help_width - col;
+        size_t line_len = 0;
+        std::string_view desc = trim(e.desc);
+        while (!desc.empty()) {
+          size_t end = 0;
+          while (end < desc.size() && !isblank(desc[end]) && desc[end] != '\n')
+            ++end;
+          std::string_view word = desc.substr(0, end);
+          desc.remove_prefix(end);
+          while (!desc.empty() && (isblank(desc[0]) || desc[0] == '\n'))
+            desc.remove_prefix(1);
+
+          if (line_len > 0 && line_len + 1 + word.size() > avail) {
+            w.put('\n');
+            w.pad(col);
+            line_len = 0;
+          }
+          else if (line_len > 0) {
+            w.put(' ');
+            ++line_len;
+          }
+          w.put(word);
+          line_len += word.size();
+        }
+        w.put('\n');
+      }
+      return w.size;
+    }
+
+    template <
+      fixed_string... Ss, size_t... Ns, class... Fs, repeat_policy... Ps,
+      fixed_string... Ds, fixed_string... Ms>
+    constexpr decltype(auto) help_entries(
+      type_sequence<opt_impl<Ss, Ns, Fs, Ps, Ds, Ms>...> seq) {
+      std::initializer_list<help_entry> all = {
+        {std::string_view(Ss), Ns, std::string_view(Ds),
+         std::string_view(Ms)}...};
+      std::array<help_entry, count_shorts(seq) + count_longs(seq)> arr;
+
+      auto it = arr.begin();
+      for (const auto& e : all) {
+        if (classify_opt(e.sw, e.nargs) != opt_type::pos_arg)
+          *it++ = e;
+      }
+      return arr;
+    }
+
+    // The formatted option list for a sequence of options, as a fixed_string.
+    template <class OptSeq>
+    inline constexpr auto help_text_v = [] {
+      constexpr auto entries = help_entries(OptSeq {});
+      constexpr size_t size  = format_help(entries, nullptr);
+      fixed_string<size> res {};
+      format_help(entries, res.begin());
+      return res;
+    }();
   }  // namespace details
 
   template <class... Opts>
   class parser;
 
-  template <fixed_string... Ns, size_t... Ss, class... Fs>
-  class parser<details::opt_impl<Ns, Ss, Fs>...> {
+  template <
+    fixed_string... Ns, size_t... Ss, class... Fs, repeat_policy... Ps,
+    fixed_string... Ds, fixed_string... Ms>
+  class parser<details::opt_impl<Ns, Ss, Fs, Ps, Ds, Ms>...> {
     static_assert(
       string_pack_unique_v<Ns...>, "All option switches must be unique");
 
   private:
-    using vtable_short_t = std::unordered_map<
-      char, size_t (*)(std::tuple<Fs...>&, int, const char*[], int, int)>;
-    using vtable_long_t = std::unordered_map<
-      std::string_view,
-      size_t (*)(std::tuple<Fs...>&, int, const char*[], int)>;
+    // Position of an option's first value in argv. clip is the offset into
+    // that argument for spliced short options. index == 0 means "not seen".
+    struct arg_pos {
+      int index;
+      int clip;
+    };
+    // Last recorded position of each last_wins option, indexed by option.
+    using deferred_t = std::array<arg_pos, sizeof...(Fs)>;
+
+    // Repeat policy of option I. std::integer_sequence cannot hold enums, so
+    // this indexes an array instead.
+    template <size_t I>
+    static constexpr repeat_policy policy_of =
+      std::array<repeat_policy, sizeof...(Ps)> {Ps...}[I];
+
+    using dispatch_short_t =
+      size_t (*)(std::tuple<Fs...>&, deferred_t&, int, const char*[], int, int);
+    using dispatch_long_t =
+      size_t (*)(std::tuple<Fs...>&, deferred_t&, int, const char*[], int);
+
+    // Last value text of each last_wins option in the config files.
+    // A null data() means "not seen".
+    using config_deferred_t = std::array<std::string_view, sizeof...(Fs)>;
+    using dispatch_config_t =
+      void (*)(std::tuple<Fs...>&, config_deferred_t&, std::string_view);
+
+    struct long_entry {
+      std::string_view name;
+      dispatch_long_t dispatch;
+      dispatch_config_t dispatch_config;
+    };
 
+    // Kept behind a pointer so that the parser stays move-assignable even
+    // when the callbacks (e.g. capturing lambdas) are not.
     std::unique_ptr<std::tuple<Fs...>> ctable;
-    vtable_short_t short_vtable;
-    vtable_long_t long_vtable;
+    // Config files are kept so that values passed to callbacks remain valid
+    // for the parser's lifetime.
+    std::vector<std::unique_ptr<details::config_source>> configs;
+    // last_wins values from config files, applied by the next parse() unless
+    // argv sets the same option.
+    config_deferred_t config_values {};
+
+    template <size_t I>
+    static constexpr bool is_help_option = std::is_same_v<
+      std::remove_cvref_t<std::tuple_element_t<I, std::tuple<Fs...>>>,
+      print_help_t>;
+
+    static constexpr auto make_usage_tail() {
+      constexpr auto posarg = details::find_posarg(
+        type_sequence<details::opt_impl<Ns, Ss, Fs, Ps, Ds, Ms>...> {});
+      if constexpr (posarg.has_value())
+        return fixed_string(" [OPTION]... [ARG]...\n\nOptions:\n") + help_text;
+      else
+        return fixed_string(" [OPTION]...\n\nOptions:\n") + help_text;
+    }
+
+    // Prints the usage line and help text, then exits. On POSIX this is a
+    // single writev(2) unless the write comes up short.
+    [[noreturn]] static void print_help_and_exit(const char* prog) {
+      static constexpr auto tail = make_usage_tail();
+      std::string_view parts[] = {
+        "Usage: ", prog, std::string_view(tail)};
+      // earlier output from callbacks must come first
+      std::fflush(stdout);
+#ifdef _MTAP_POSIX_
+      struct iovec iov[3];
+      for (size_t i = 0; i < 3; i++)
+        iov[i] = {const_cast<char*>(parts[i].data()), parts[i].size()};
+      struct iovec* it = iov;
+      int count        = 3;
+      while (count > 0) {
+        ssize_t n = ::writev(1, it, count);
+        if (n <= 0)
+          break;
+        // skip what was written, which may end partway through an iovec
+        while (count > 0 && size_t(n) >= it->iov_len) {
+          n -= it->iov_len;
+          ++it;
+          --count;
+        }
+        if (count > 0) {
+          it->iov_base = static_cast<char*>(it->iov_base) + n;
+          it->iov_len -= n;
+        }
+      }
+#else
+      for (std::string_view part : parts)
+        std::fwrite(part.data(), 1, part.size(), stdout);
+      std::fflush(stdout);
+#endif
+      exit(0);
+    }
+
+    // Runs the callback for option I on the values starting at pos.
+    template <size_t I>
+    static void invoke(
+      std::tuple<Fs...>& tup, const char* argv[], arg_pos pos) {
+      constexpr size_t arg_size =
+        integer_sequence_element_v<I, std::index_sequence<Ss...>>;
+      if constexpr (is_help_option<I>) {
+        static_assert(arg_size == 0, "Help option cannot take arguments");
+        print_help_and_exit(argv[0]);
+      }
+      else if constexpr (arg_size == 0) {
+        std::get<I>(tup)();
+      }
+      else {
+        // Only the first value can be spliced.
+        [&]<size_t... Is>(std::index_sequence<Is...>) {
+          std::get<I>(tup)((argv[pos.index + Is] + (Is == 0 ? pos.clip : 0))...);
+        }
+        (std::make_index_sequence<arg_size> {});
+      }
+    }
+
+    // Runs the callback for option I now, or records pos for later if the
+    // option is last_wins.
+    template <size_t I>
+    static void invoke_or_defer(
+      std::tuple<Fs...>& tup, deferred_t& deferred, const char* argv[],
+      arg_pos pos) {
+      if constexpr (policy_of<I> == last_wins)
+        deferred[I] = pos;
+      else
+        invoke<I>(tup, argv, pos);
+    }
+
+    // Runs the callbacks of all last_wins options that were seen, once each.
+    // A value from argv takes priority over one from a config file.
+    static void flush_deferred(
+      std::tuple<Fs...>& tup, const deferred_t& deferred,
+      const config_deferred_t& config_values, const char* argv[]) {
+      [&]<size_t... Is>(std::index_sequence<Is...>) {
+        (
+          [&] {
+            if constexpr (Ps == last_wins) {
+              if (deferred[Is].index != 0)
+                invoke<Is>(tup, argv, deferred[Is]);
+              else if (config_values[Is].data() != nullptr)
+                invoke_config<Is>(tup, config_values[Is]);
+            }
+          }(),
+          ...);
+      }
+      (std::make_index_sequence<sizeof...(Fs)> {});
+    }
 
     // Dispatches short options.
     // iarg = first arg containing argument values
@@ -253,17 +657,18 @@ namespace mtap {
     // Returns the number of arguments for the dispatched option.
     template <size_t I>
     static size_t dispatch_short(
-      std::tuple<Fs...>& tup, int argc, const char* argv[], int iarg,
-      int clip) {
+      std::tuple<Fs...>& tup, deferred_t& deferred, int argc,
+      const char* argv[], int iarg, int clip) {
       constexpr size_t arg_size =
         integer_sequence_element_v<I, std::index_sequence<Ss...>>;
       if constexpr (arg_size == 0) {
-        std::get<I>(tup)();
+        invoke_or_defer<I>(tup, deferred, argv, {iarg, 0});
       }
       else if constexpr (arg_size == 1) {
         if (iarg + (clip ? 0 : 1) >= argc)
           throw argument_error("Not enough arguments remaining");
-        std::get<I>(tup)(argv[iarg + (clip ? 0 : 1)] + clip);
+        invoke_or_defer<I>(
+          tup, deferred, argv, {iarg + (clip ? 0 : 1), clip});
       }
       else {
         if (clip)
@@ -271,60 +676,129 @@ namespace mtap {
             "Multi-arg short option cannot be specified in the same argument");
         if (iarg + arg_size >= argc)
           throw argument_error("Not enough arguments remaining");
-        // Inline pack expansion to split the next arg_size arguments into
-        // parameters.
-        [&]<size_t... Is>(std::index_sequence<Is...>) {
-          std::get<I>(tup)(argv[iarg + 1 + Is]...);
-        }
-        (std::make_index_sequence<arg_size> {});
+        invoke_or_defer<I>(tup, deferred, argv, {iarg + 1, 0});
       }
       return arg_size;
     }
 
     template <size_t I>
     static size_t dispatch_long(
-      std::tuple<Fs...>& tup, int argc, const char* argv[], int iarg) {
+      std::tuple<Fs...>& tup, deferred_t& deferred, int argc,
+      const char* argv[], int iarg) {
       constexpr size_t arg_size =
         integer_sequence_element_v<I, std::index_sequence<Ss...>>;
       if (iarg + arg_size >= argc)
         throw argument_error("Not enough arguments remaining");
+      if constexpr (arg_size == 0) {
+        invoke_or_defer<I>(tup, deferred, argv, {iarg, 0});
+      }
+      else {
+        invoke_or_defer<I>(tup, deferred, argv, {iarg + 1, 0});
+      }
+      return arg_size;
+    }
+
+    // Runs the callback for option I on a config value. The value is split
+    // into fields for multi-arg options.
+    template <size_t I>
+    static void invoke_config(std::tuple<Fs...>& tup, std::string_view value) {
+      constexpr size_t arg_size =
+        integer_sequence_element_v<I, std::index_sequence<Ss...>>;
       if constexpr (arg_size == 0) {
         std::get<I>(tup)();
       }
+      else if constexpr (arg_size == 1) {
+        std::get<I>(tup)(value);
+      }
       else {
+        std::array<std::string_view, arg_size> fields;
+        details::split_fields(value, fields.data(), arg_size);
         [&]<size_t... Is>(std::index_sequence<Is...>) {
-          std::get<I>(tup)(argv[iarg + Is + 1]...);
+          std::get<I>(tup)(fields[Is]...);
         }
         (std::make_index_sequence<arg_size> {});
       }
-      return arg_size;
     }
 
-    static vtable_short_t make_short_vtable() {
+    // Dispatches a long option from a config file.
+    template <size_t I>
+    static void dispatch_config(
+      std::tuple<Fs...>& tup, config_deferred_t& deferred,
+      std::string_view value) {
+      constexpr size_t arg_size =
+        integer_sequence_element_v<I, std::index_sequence<Ss...>>;
+      if constexpr (is_help_option<I>) {
+        throw argument_error("Option cannot be used in a config file");
+      }
+      else if constexpr (arg_size == 0) {
+        if (!value.empty())
+          throw argument_error("Option does not take a value");
+      }
+      else if constexpr (arg_size == 1) {
+        if (value.empty())
+          throw argument_error("Option requires a value");
+      }
+      else if constexpr (arg_size > 1) {
+        if (details::split_fields(value, nullptr, 0) != arg_size)
+          throw argument_error("Wrong number of values for option");
+      }
+      if constexpr (policy_of<I> == last_wins)
+        deferred[I] = value;
+      else
+        invoke_config<I>(tup, value);
+    }
+
+    // The vtables are built at compile time, so they need neither heap
+    // allocation nor static initialization.
+    static constexpr auto make_short_vtable() {
       constexpr auto vals = details::filter_shorts(
-        type_sequence<details::opt_impl<Ns, Ss, Fs>...> {});
+        type_sequence<details::opt_impl<Ns, Ss, Fs, Ps, Ds, Ms>...> {});
       return [&]<size_t... Is>(std::index_sequence<Is...>) {
-        return vtable_short_t {
-          {vals[Is].first, dispatch_short<vals[Is].second>}...};
+        return std::array<std::pair<char, dispatch_short_t>, vals.size()> {
+          {{vals[Is].first, dispatch_short<vals[Is].second>}...}};
       }
       (std::make_index_sequence<vals.size()> {});
     }
 
-    static vtable_long_t make_long_vtable() {
+    static constexpr auto make_long_vtable() {
       constexpr auto vals = details::filter_longs(
-        type_sequence<details::opt_impl<Ns, Ss, Fs>...> {});
+        type_sequence<details::opt_impl<Ns, Ss, Fs, Ps, Ds, Ms>...> {});
       return [&]<size_t... Is>(std::index_sequence<Is...>) {
-        return vtable_long_t {
-          {vals[Is].first, dispatch_long<vals[Is].second>}...};
+        return std::array<long_entry, vals.size()> {
+          {{vals[Is].first, dispatch_long<vals[Is].second>,
+            dispatch_config<vals[Is].second>}...}};
       }
       (std::make_index_sequence<vals.size()> {});
     }
 
+    static dispatch_short_t find_short(char sw) {
+      static constexpr auto vtable = make_short_vtable();
+      auto it = std::find_if(vtable.begin(), vtable.end(), [&](const auto& p) {
+        return p.first == sw;
+      });
+      if (it == vtable.end())
+        throw argument_error("Cannot use option");
+      return it->second;
+    }
+
+    static const long_entry& find_long(std::string_view sw) {
+      static constexpr auto vtable = make_long_vtable();
+      auto it = std::find_if(vtable.begin(), vtable.end(), [&](const auto& e) {
+        return e.name == sw;
+      });
+      if (it == vtable.end())
+        throw argument_error("Cannot use option");
+      return *it;
+    }
+
   public:
-    parser(details::opt_impl<Ns, Ss, Fs>&&... opts) :
-        ctable(new std::tuple<Fs...>(std::move(opts.fn)...)),
-        short_vtable(make_short_vtable()),
-        long_vtable(make_long_vtable()) {}
+    // The option list for --help, formatted at compile time. Options given
+    // mtap::print_help as their callback print it automatically.
+    static constexpr auto help_text = details::help_text_v<
+      type_sequence<details::opt_impl<Ns, Ss, Fs, Ps, Ds, Ms>...>>;
+
+    parser(details::opt_impl<Ns, Ss, Fs, Ps, Ds, Ms>&&... opts) :
+        ctable(new std::tuple<Fs...>(std::move(opts.fn)...)) {}
 
     // Special methods
 
@@ -340,7 +814,8 @@ namespace mtap {
     void main_parser(int argc, const char* argv[]) {
       bool parse_opts              = true;
       static constexpr auto posarg = details::find_posarg(
-        type_sequence<details::opt_impl<Ns, Ss, Fs>...> {});
+        type_sequence<details::opt_impl<Ns, Ss, Fs, Ps, Ds, Ms>...> {});
+      deferred_t deferred {};
       for (int i = 1; i < argc;) {
         const char* arg = argv[i];
         if (arg[0] == '-' && parse_opts) {
@@ -348,16 +823,13 @@ namespace mtap {
             if (arg[2] == '\0') {
               // argument is '--', stop
               parse_opts = false;
+              ++i;
+              continue;
             }
             else if (details::isalnum(arg[2])) {
               // argument is long option
-              size_t last_narg;
-              try {
-                last_narg = long_vtable.at(arg + 2)(*ctable, argc, argv, i);
-              }
-              catch (const std::out_of_range& out) {
-                std::throw_with_nested(argument_error("Cannot use option"));
-              }
+              size_t last_narg = find_long(arg + 2).dispatch(
+                *ctable, deferred, argc, argv, i);
               i += last_narg + 1;
               continue;
             }
@@ -369,13 +841,9 @@ namespace mtap {
             size_t last_narg;
             for (size_t j = 1; arg[j] != '\0'; j++) {
               // clip == 0 signals "don't splice"
-              try {
-                last_narg = short_vtable.at(arg[j])(
-                  *ctable, argc, argv, i, (arg[j + 1] == '\0') ? 0 : j + 1);
-              }
-              catch (const std::out_of_range& out) {
-                std::throw_with_nested(argument_error("Cannot use option"));
-              }
+              last_narg = find_short(arg[j])(
+                *ctable, deferred, argc, argv, i,
+                (arg[j + 1] == '\0') ? 0 : j + 1);
               if (last_narg == 0) {
                 if (arg[j + 1] == '\0')
                   ++i;
@@ -398,7 +866,8 @@ namespace mtap {
           }
           else {
             if constexpr (posarg.has_value()) {
-              std::get<posarg.value()> (*ctable)(argv[i++]);
+              invoke_or_defer<posarg.value()>(
+                *ctable, deferred, argv, {i++, 0});
             }
             else {
               ++i;
@@ -408,7 +877,8 @@ namespace mtap {
         }
         else {
           if constexpr (posarg.has_value()) {
-            std::get<posarg.value()> (*ctable)(argv[i++]);
+            invoke_or_defer<posarg.value()>(
+              *ctable, deferred, argv, {i++, 0});
           }
           else {
             ++i;
@@ -417,23 +887,119 @@ namespace mtap {
         }
         throw std::logic_error("INTERNAL ERROR: parsing loop incomplete");
       }
+      flush_deferred(*ctable, deferred, config_values, argv);
+      config_values = {};
+    }
+
+    // Parses "key = value" lines. Keys are long option names without the
+    // leading dashes. Blank lines and lines starting with '#' are skipped.
+    // On error, line and col are set to the 1-based position of the problem.
+    // last_wins values are stored in config_values for main_parser.
+    void config_parser(std::string_view text, size_t& line, size_t& col) {
+      line = 0;
+      while (!text.empty()) {
+        ++line;
+        size_t eol = text.find('\n');
+        std::string_view row = text.substr(0, eol);
+        text.remove_prefix(eol == text.npos ? text.size() : eol + 1);
+
+        const char* const row_begin = row.data();
+        auto column = [&](std::string_view at) {
+          return size_t(at.data() - row_begin) + 1;
+        };
+
+        row = details::trim(row);
+        if (row.empty() || row[0] == '#')
+          continue;
+
+        size_t key_end = 0;
+        while (key_end < row.size() && row[key_end] != '=' &&
+               !details::isblank(row[key_end]))
+          ++key_end;
+        std::string_view key  = row.substr(0, key_end);
+        std::string_view rest = details::trim(row.substr(key_end));
+        col                   = column(key);
+
+        if (key.empty())
+          throw argument_error("Missing option name");
+        const long_entry& entry = find_long(key);
+
+        // value always points into the mapping, even when empty, so that it
+        // is distinguishable from "not seen" in config_values
+        std::string_view value = rest.substr(rest.size());
+        if (!rest.empty()) {
+          col = column(rest);
+          if (rest[0] != '=')
+            throw argument_error("Expected '='");
+          value = details::trim(rest.substr(1));
+        }
+        // point at the value, or where it is missing
+        col = value.empty() ? column(row) + row.size() : column(value);
+        entry.dispatch_config(*ctable, config_values, value);
+      }
+      col = 0;
+    }
+
+    template <class E>
+    void report_config_error(
+      const char* path, size_t line, size_t col, const char* what,
+      E&& on_error) {
+      if (line == 0) {
+        on_error(path, what);
+      }
+      else {
+        std::string where = std::string(path) + ':' + std::to_string(line) +
+          ':' + std::to_string(col);
+        on_error(where, what);
+      }
     }
 
   public:
-    // Parse
+    // Applies options from a "key = value" config file that has already been
+    // read; use mtap::parse_config from mtap/config.hpp instead. The parser
+    // keeps src alive. Errors are reported to on_error with "path:line:col".
+    // Callbacks of last_wins options run in parse(), once, with the value
+    // from argv if it has one and from the last config file line otherwise.
+    template <
+      details::callable<void(std::string_view, std::string_view)> E>
+    void apply_config(
+      std::unique_ptr<details::config_source> src, const char* path,
+      E&& on_error) {
+      size_t line = 0, col = 0;
+      try {
+        configs.push_back(std::move(src));
+        config_parser(configs.back()->view(), line, col);
+      }
+      catch (const argument_error& err) {
+        report_config_error(path, line, col, err.what(), on_error);
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    // Parse, reporting errors to standard error.
     void parse(int argc, const char* argv[]) {
+      parse(argc, argv, details::report_error);
+    }
+
+    // Parse, reporting errors to a custom sink. The sink receives the program
+    // name and the error message.
+    template <
+      details::callable<void(std::string_view, std::string_view)> E>
+    void parse(int argc, const char* argv[], E&& on_error) {
       try {
         main_parser(argc, argv);
       }
       catch (const argument_error& err) {
-        std::cerr << argv[0] << ": " << err.what() << '\n';
+        on_error(argv[0], err.what());
         exit(0);
       }
     }
   };
 
-  template <fixed_string... Ns, size_t... Ss, class... Fs>
-  parser(details::opt_impl<Ns, Ss, Fs>...)
-    -> parser<details::opt_impl<Ns, Ss, Fs>...>;
+  template <
+    fixed_string... Ns, size_t... Ss, class... Fs, repeat_policy... Ps,
+    fixed_string... Ds, fixed_string... Ms>
+  parser(details::opt_impl<Ns, Ss, Fs, Ps, Ds, Ms>...)
+    -> parser<details::opt_impl<Ns, Ss, Fs, Ps, Ds, Ms>...>;
 }  // namespace mtap
 #endif
\ No newline at end of file
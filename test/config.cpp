@@ -0,0 +1,34 @@
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+#include <mtap/config.hpp>
+#include <mtap/mtap.hpp>
+
+using mtap::option, mtap::pos_arg;
+
+// Usage: config <config-file> [args...]
+int main(int argc, const char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <config-file> [args...]\n";
+    return 1;
+  }
+  mtap::parser p {
+    option<"--verbose", 0>([]() {
+      std::cout << "--verbose\n";
+    }),
+    option<"--output", 1>([](std::string_view val) {
+      std::cout << "--output: " << val << "\n";
+    }),
+    option<"--log-level", 1, mtap::last_wins>([](std::string_view val) {
+      std::cout << "--log-level: " << val << "\n";
+    }),
+    option<"--size", 2>([](std::string_view w, std::string_view h) {
+      std::cout << "--size: " << w << " x " << h << "\n";
+    }),
+    pos_arg([](std::string_view arg) {
+      std::cout << "posarg: " << arg << "\n";
+    }),
+  };
+  mtap::parse_config(p, argv[1]);
+  p.parse(argc - 1, argv + 1);
+}
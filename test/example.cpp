@@ -16,19 +16,19 @@ void print_csv(const T& x) {
 
 int main(int argc, const char* argv[]) {
   mtap::parser(
-    option<"--help", 0>([]() {
-      std::cout << "Some usage options\n";
-      std::exit(0);
-    }),
-    option<"-a", 0>([]() {
+    option<"--help", 0, "Display this help and exit">(mtap::print_help),
+    option<"-a", 0, "Set option A">([]() {
       std::cout << "Option A set\n";
     }),
-    option<"-b", 0>([]() {
+    option<"-b", 0, "Set option B. This description is long enough that it has to be wrapped onto the next line">([]() {
       std::cout << "Option B set\n";
     }),
-    option<"-c", 1>([](std::string_view value) {
+    option<"-c", 1, "Set option C to VALUE", "VALUE">([](std::string_view value) {
       std::cout << "Option C set, value = " << value << '\n';
     }),
+    option<"--size", 2>([](std::string_view w, std::string_view h) {
+      std::cout << "Size set, value = " << w << " x " << h << '\n';
+    }),
     pos_arg([](std::string_view value) {
       std::cout << "Positional argument: " << value << '\n';
     })
@@ -0,0 +1,25 @@
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+#include <mtap/mtap.hpp>
+
+using mtap::option, mtap::pos_arg;
+
+int main(int argc, const char* argv[]) {
+  mtap::parser {
+    option<"--log-level", 1, mtap::last_wins>([](std::string_view val) {
+      std::cout << "--log-level: " << val << "\n";
+    }),
+    option<"-o", 1, mtap::last_wins, "Write output to FILE", "FILE">(
+      [](std::string_view val) {
+        std::cout << "-o: " << val << "\n";
+      }),
+    option<"--help", 0, "Display this help and exit">(mtap::print_help),
+    option<"-v", 0>([]() {
+      std::cout << "-v\n";
+    }),
+    pos_arg([](std::string_view arg) {
+      std::cout << "posarg: " << arg << "\n";
+    }),
+  }.parse(argc, argv);
+}